@@ -37,13 +37,36 @@
  *      record size. For this excercise, I chose the fixed number of character approach and
  *      defined a struct data type of 96 bytes to avoid memory fragmentation. This approach
  *      reduces memory handlings. I've chosen TIME over SPACE. 
+ *
+ * 4. Cache friendly layout (hot/cold split)
+ *      A 96 byte record straddles cache lines, and probing only needs the key. So the cache
+ *      keeps three arrays instead of one queue of records:
+ *          - hash buckets: one cache line each, 8 (fingerprint, slot) pairs.
+ *          - keys: 16 byte ISBNs indexed by queue slot, 4 per cache line.
+ *          - payloads: title/author/language indexed by queue slot, only read on a hit.
+ *      A lookup touches one bucket line, one key line on a fingerprint match, and the payload
+ *      only when the key matches. get_book_info_batch() additionally prefetches the buckets,
+ *      keys and payloads of a window of lookups ahead, so their memory latencies overlap.
+ *      Measured against whole records behind the same index (__BOOK_INFO_AOS_LAYOUT__),
+ *      the split is on par for hits, since a hit still reads a bucket and a full record;
+ *      most of the gain over the old queue comes from the bucket index and the batching.
+ *      Trade-off: a bucket holds at most 8 keys, and a full bucket drops its oldest entry.
+ *      The cache therefore no longer strictly keeps the last N records. A dropped record
+ *      stays in the queue but can no longer be found, until its slot is reused. With about
+ *      2 keys per bucket on average this is rare.
+ *
+ * Define __BOOK_INFO_AOS_LAYOUT__ to store whole TBookInfo records instead (the old layout,
+ * kept as a benchmark baseline). Define __BOOK_INFO_LIBRARY__ before including this file to use the cache without the unit
+ * test main() (see picovoice_Q1_bench.c).
  */
 
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 
+#ifndef __BOOK_INFO_LIBRARY__
 #define __TEST_UNIT__ // for unit testing.
+#endif
 
 #ifdef __TEST_UNIT__
 // caching status on simulated queries.
@@ -53,7 +76,9 @@ int num_hashing_collision = 0;
 #endif
 
 
+#ifndef __BOOK_INFO_RECORD_MAX_SIZE__
 #define __BOOK_INFO_RECORD_MAX_SIZE__   1000 // N size.
+#endif
 
 /****************************************************************************************
  * @brief Custom Book Information Data Type (96 Bytes).
@@ -65,7 +90,7 @@ int num_hashing_collision = 0;
 #define __BOOK_INFO_LANGUAGE_LENGTH__   4
 
 typedef struct MyCustomBookInfo {
-    char isbn[__BOOK_INFO_TITLE_LENGTH__];
+    char isbn[__BOOK_INFO_ISBN_LENGTH__];
     char title[__BOOK_INFO_TITLE_LENGTH__];
     char author[__BOOK_INFO_AUTHOR_LENGTH__];
     char language[__BOOK_INFO_LANGUAGE_LENGTH__];
@@ -76,18 +101,65 @@ void set_book_info_record(PTBookInfo record, char* isbn, char* title, char* auth
 void copy_book_info_record(PTBookInfo dest, PTBookInfo src);
 
 
+/******************************************************************************
+ * @brief Hot/cold split of the lookup queue.
+ *        Hot: hash buckets and keys, scanned on every lookup.
+ *        Cold: the rest of the record, read only on a hit.
+ */
+#define __CACHE_LINE_SIZE__             64
+#define __BOOK_INFO_BUCKET_WAYS__       8
+#define __BOOK_INFO_BUCKET_COUNT__      (__BOOK_INFO_RECORD_MAX_SIZE__ / 2 + 1) // ~2 of 8 ways used on average.
+#define __BOOK_INFO_BATCH_WINDOW__      16 // lookups in flight in get_book_info_batch().
+
+#ifdef _MSC_VER
+#include <xmmintrin.h>
+#define __CACHE_ALIGNED__               __declspec(align(__CACHE_LINE_SIZE__))
+#define __PREFETCH__(address)           _mm_prefetch((const char*)(address), _MM_HINT_T0)
+#else
+#define __CACHE_ALIGNED__               __attribute__((aligned(__CACHE_LINE_SIZE__)))
+#define __PREFETCH__(address)           __builtin_prefetch(address)
+#endif
+
+// one cache line. entry holds queue slot + 1, so 0 marks an empty way.
+typedef struct __CACHE_ALIGNED__ BookKeyBucket {
+    unsigned fingerprint[__BOOK_INFO_BUCKET_WAYS__];
+    int entry[__BOOK_INFO_BUCKET_WAYS__];
+} TBookKeyBucket;
+
+typedef struct BookKey {
+    char isbn[16]; // __BOOK_INFO_ISBN_LENGTH__ padded, 4 keys per cache line.
+} TBookKey;
+
+typedef struct BookPayload {
+    char title[__BOOK_INFO_TITLE_LENGTH__];
+    char author[__BOOK_INFO_AUTHOR_LENGTH__];
+    char language[__BOOK_INFO_LANGUAGE_LENGTH__];
+} TBookPayload;
+
 /******************************************************************************
  * @brief Lookup queue and hash table and their associated functions
  *        These are declared as static to limit their scope to this file.
  * 
  */
+static __CACHE_ALIGNED__ TBookKeyBucket isbn_hash_table[__BOOK_INFO_BUCKET_COUNT__];
+#ifdef __BOOK_INFO_AOS_LAYOUT__
+// baseline for benchmarking: whole 96 byte records, same bucket index.
 static TBookInfo queue[__BOOK_INFO_RECORD_MAX_SIZE__];
-static int isbn_hash_table[__BOOK_INFO_RECORD_MAX_SIZE__];
+#define __QUEUE_KEY__(slot)             (queue[slot].isbn)
+#define __QUEUE_PAYLOAD__(slot)         (&queue[slot])
+#else
+static __CACHE_ALIGNED__ TBookKey queue_keys[__BOOK_INFO_RECORD_MAX_SIZE__];
+static TBookPayload queue_payloads[__BOOK_INFO_RECORD_MAX_SIZE__];
+#define __QUEUE_KEY__(slot)             (queue_keys[slot].isbn)
+#define __QUEUE_PAYLOAD__(slot)         (&queue_payloads[slot])
+#endif
 static int record_runner = 0;
 
-static unsigned get_isbn_key(char* isbn); // basic hashing function.
-static int search_book_info_queue(char* isbn); // searching queue.
-static void append_book_info_record(PTBookInfo record); // update queue and hash.
+static unsigned long long get_isbn_hash(char* isbn); // basic hashing function.
+static TBookKeyBucket* get_isbn_bucket(unsigned long long hash);
+static int search_book_info_queue(char* isbn, unsigned long long hash); // searching queue.
+static void append_book_info_record(PTBookInfo record, unsigned long long hash); // update queue and hash.
+static void load_book_info_record(int slot, PTBookInfo record); // joins key and payload.
 
 // Mock up DB handling function. Creates mock up book info data.
 TBookInfo retreive_book_info_from_db(char* isbn) {
@@ -103,17 +175,20 @@ TBookInfo retreive_book_info_from_db(char* isbn) {
  * @return TBookInfo 
  */
 TBookInfo get_book_info(char* isbn) {
-    int search_result = search_book_info_queue(isbn);
+    unsigned long long hash = get_isbn_hash(isbn);
+    int search_result = search_book_info_queue(isbn, hash);
     if(search_result >= 0) {
 
 #ifdef __TEST_UNIT__
         num_record_found_in_table++;
 #endif
 
-        return queue[search_result];
+        TBookInfo record;
+        load_book_info_record(search_result, &record);
+        return record;
     } else {
         TBookInfo record = retreive_book_info_from_db(isbn);
-        append_book_info_record(&record);
+        append_book_info_record(&record, hash);
 
 #ifdef __TEST_UNIT__
         num_record_not_found_in_table++;
@@ -122,6 +197,69 @@ TBookInfo get_book_info(char* isbn) {
     }
 }
 
+/******************************************************************************
+ * @brief Batched version of get_book_info(). Lookups are processed in windows
+ *        of __BOOK_INFO_BATCH_WINDOW__: first all bucket lines of the window are
+ *        prefetched, then the key and payload lines of each candidate, and only then
+ *        are the keys compared, so the cache misses of a window overlap.
+ * 
+ * @param isbns 
+ * @param count 
+ * @param records output, one record per isbn.
+ */
+void get_book_info_batch(char** isbns, int count, PTBookInfo records) {
+    unsigned long long hashes[__BOOK_INFO_BATCH_WINDOW__];
+    int candidates[__BOOK_INFO_BATCH_WINDOW__];
+
+    for(int base = 0; base < count; base += __BOOK_INFO_BATCH_WINDOW__) {
+        int window = count - base < __BOOK_INFO_BATCH_WINDOW__ ? count - base : __BOOK_INFO_BATCH_WINDOW__;
+
+        // stage 1: hash and prefetch the buckets.
+        for(int i = 0; i < window; i++) {
+            hashes[i] = get_isbn_hash(isbns[base + i]);
+            __PREFETCH__(get_isbn_bucket(hashes[i]));
+        }
+
+        // stage 2: pick the first fingerprint match and prefetch its key and payload.
+        for(int i = 0; i < window; i++) {
+            TBookKeyBucket* bucket = get_isbn_bucket(hashes[i]);
+            unsigned fingerprint = (unsigned)hashes[i];
+            candidates[i] = -1;
+            for(int way = 0; way < __BOOK_INFO_BUCKET_WAYS__; way++) {
+                if(bucket->entry[way] && bucket->fingerprint[way] == fingerprint) {
+                    candidates[i] = bucket->entry[way] - 1;
+                    __PREFETCH__(__QUEUE_KEY__(candidates[i]));
+                    __PREFETCH__(__QUEUE_PAYLOAD__(candidates[i]));
+                    break;
+                }
+            }
+        }
+
+        // stage 3: compare keys. Misses earlier in the window may have replaced
+        // a candidate, so anything but an exact match goes through the full search.
+        for(int i = 0; i < window; i++) {
+            char* isbn = isbns[base + i];
+            int slot = candidates[i];
+            if(slot < 0 || strcmp(__QUEUE_KEY__(slot), isbn)) {
+                slot = search_book_info_queue(isbn, hashes[i]);
+            }
+
+            if(slot >= 0) {
+#ifdef __TEST_UNIT__
+                num_record_found_in_table++;
+#endif
+                load_book_info_record(slot, &records[base + i]);
+            } else {
+                records[base + i] = retreive_book_info_from_db(isbn);
+                append_book_info_record(&records[base + i], hashes[i]);
+#ifdef __TEST_UNIT__
+                num_record_not_found_in_table++;
+#endif
+            }
+        }
+    }
+}
+
 /******************************************************************************
  * @brief Unit Testing Section.
  * 
@@ -137,21 +275,36 @@ int main() {
 
     // populate the cache
     for(int i = k; i < k+__BOOK_INFO_RECORD_MAX_SIZE__; i++) {
-        get_book_info(itoa(i, buffer, 10));
+        sprintf(buffer, "%d", i);
+        get_book_info(buffer);
     }
     // retrieve from the cache
     for(int i = k; i < k+__BOOK_INFO_RECORD_MAX_SIZE__; i++) {
-        get_book_info(itoa(i, buffer, 10));
+        sprintf(buffer, "%d", i);
+        get_book_info(buffer);
+    }
+    // retrieve from the cache in batches
+    char batch_buffers[__BOOK_INFO_BATCH_WINDOW__][__BOOK_INFO_ISBN_LENGTH__];
+    char* batch[__BOOK_INFO_BATCH_WINDOW__];
+    TBookInfo batch_records[__BOOK_INFO_BATCH_WINDOW__];
+    for(int i = k; i < k+__BOOK_INFO_RECORD_MAX_SIZE__; i += __BOOK_INFO_BATCH_WINDOW__) {
+        int count = 0;
+        for(int j = i; j < i+__BOOK_INFO_BATCH_WINDOW__ && j < k+__BOOK_INFO_RECORD_MAX_SIZE__; j++) {
+            sprintf(batch_buffers[count], "%d", j);
+            batch[count] = batch_buffers[count];
+            count++;
+        }
+        get_book_info_batch(batch, count, batch_records);
     }
 
     // display result stats.
     printf("==================================================================\n");
-    printf("Simulating %d number of book info search queries:\n", __BOOK_INFO_RECORD_MAX_SIZE__*2);
-    printf("Each ISBN number is requested twice.\n");
+    printf("Simulating %d number of book info search queries:\n", __BOOK_INFO_RECORD_MAX_SIZE__*3);
+    printf("Each ISBN number is requested three times, the last time in batches.\n");
     printf("------------------------------------------------------------------\n");
 
     printf("%d number of records found in look up table.\n", num_record_found_in_table);
-    printf("%d number of records not found the table.\n", num_record_found_in_table);
+    printf("%d number of records not found the table.\n", num_record_not_found_in_table);
     printf("%d number of hashing collisions occurred\n\n", num_hashing_collision);
     printf("==================================================================\n");
     printf("Printing a sample book info record...\n");
@@ -175,21 +328,71 @@ void copy_book_info_record(PTBookInfo dest, PTBookInfo src) {
     set_book_info_record(dest, src->isbn, src->title, src->author, src->language);
 }
 
-// most basic hashing function. The integer value can be multiplied by a large prime number to 
-// reduce the collision.
-unsigned get_isbn_key(char* isbn) {
-    char buffer[__BOOK_INFO_ISBN_LENGTH__];
-    long i = _atoi64(isbn)  % __BOOK_INFO_RECORD_MAX_SIZE__;
-    return (unsigned int)(i);
+// FNV-1a over the ISBN string, finalized with the murmur3 mixer since ISBNs only differ in
+// their last few digits. The low 32 bits are the fingerprint kept in the bucket, the high
+// 32 bits pick the bucket.
+unsigned long long get_isbn_hash(char* isbn) {
+    unsigned long long hash = 14695981039346656037ULL;
+    while(*isbn) {
+        hash ^= (unsigned char)*isbn++;
+        hash *= 1099511628211ULL;
+    }
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+// maps the high 32 bits onto [0, bucket count) with a multiply instead of a modulo.
+TBookKeyBucket* get_isbn_bucket(unsigned long long hash) {
+    return &isbn_hash_table[((hash >> 32) * __BOOK_INFO_BUCKET_COUNT__) >> 32];
+}
+
+void load_book_info_record(int slot, PTBookInfo record) {
+    strcpy(record->isbn, __QUEUE_KEY__(slot));
+    strcpy(record->title, __QUEUE_PAYLOAD__(slot)->title);
+    strcpy(record->author, __QUEUE_PAYLOAD__(slot)->author);
+    strcpy(record->language, __QUEUE_PAYLOAD__(slot)->language);
 }
 
 // update look up queue and hash table.
-void append_book_info_record(PTBookInfo record) {
-    // update hash table
-    int key = get_isbn_key(record->isbn);
-    isbn_hash_table[key] = record_runner;
+void append_book_info_record(PTBookInfo record, unsigned long long hash) {
+    TBookKeyBucket* bucket;
+    int way;
+
+    // dequeuing: drop the old record at this slot from its bucket, if it is still indexed.
+    if(__QUEUE_KEY__(record_runner)[0]) {
+        bucket = get_isbn_bucket(get_isbn_hash(__QUEUE_KEY__(record_runner)));
+        for(way = 0; way < __BOOK_INFO_BUCKET_WAYS__; way++) {
+            if(bucket->entry[way] == record_runner + 1) bucket->entry[way] = 0;
+        }
+    }
+
+    // update hash table: take an empty way, or replace the oldest entry of a full bucket.
+    bucket = get_isbn_bucket(hash);
+    int victim = 0;
+    int oldest_age = -1;
+    for(way = 0; way < __BOOK_INFO_BUCKET_WAYS__; way++) {
+        if(!bucket->entry[way]) {
+            victim = way;
+            break;
+        }
+        int age = (record_runner - (bucket->entry[way] - 1) + __BOOK_INFO_RECORD_MAX_SIZE__) % __BOOK_INFO_RECORD_MAX_SIZE__;
+        if(age > oldest_age) {
+            oldest_age = age;
+            victim = way;
+        }
+    }
+    bucket->fingerprint[victim] = (unsigned)hash;
+    bucket->entry[victim] = record_runner + 1;
+
     // update look up queue(cache)
-    copy_book_info_record(&queue[record_runner], record);
+    strcpy(__QUEUE_KEY__(record_runner), record->isbn);
+    strcpy(__QUEUE_PAYLOAD__(record_runner)->title, record->title);
+    strcpy(__QUEUE_PAYLOAD__(record_runner)->author, record->author);
+    strcpy(__QUEUE_PAYLOAD__(record_runner)->language, record->language);
     record_runner++;
     // dequeuing by overwriting on the old entries.
     if(record_runner==__BOOK_INFO_RECORD_MAX_SIZE__) {
@@ -197,22 +400,21 @@ void append_book_info_record(PTBookInfo record) {
     }
 }
 
-// Look up fuction.
-int search_book_info_queue(char* isbn) {
-    // using hashing key to find the record.
-    int key = get_isbn_key(isbn);
-    if(!strcmp(queue[isbn_hash_table[key]].isbn, isbn)) return key;
+// Look up fuction. Only the bucket line and the keys of matching fingerprints are read.
+int search_book_info_queue(char* isbn, unsigned long long hash) {
+    TBookKeyBucket* bucket = get_isbn_bucket(hash);
+    unsigned fingerprint = (unsigned)hash;
 
-    // in case of collision, search through the cache for the item. linear search.
-    for(int i = 0; i < __BOOK_INFO_RECORD_MAX_SIZE__; i++) {
-        if(!strcmp(queue[i].isbn, isbn)) {
+    for(int way = 0; way < __BOOK_INFO_BUCKET_WAYS__; way++) {
+        if(bucket->entry[way] && bucket->fingerprint[way] == fingerprint) {
+            int slot = bucket->entry[way] - 1;
+            if(!strcmp(__QUEUE_KEY__(slot), isbn)) return slot;
 
 #ifdef __TEST_UNIT__
             num_hashing_collision++;
 #endif
-            return i;
         }
     }
     // not found in the cache
     return -1;
-}
\ No newline at end of file
+}
@@ -14,6 +14,14 @@
  * memory from growing unbounded, we only want to store a maximum of N book records. At any given time,
  * we should be storing the N books that we accessed most recently. Assume that N can be a large number
  * when choosing data structure(s) and algorithm(s).
+ *
+ * Cache warming: with enable_book_info_access_log(), every get_book_info() call appends
+ * its ISBN and a timestamp to a compact binary log. The lookup only pushes a 12 byte
+ * record into a lock-free ring buffer, and a background thread writes the ring to disk.
+ * After a restart or flush, warm_book_info_cache() replays the most frequent and most
+ * recent keys of that log through the batched database path, so the table is back at its
+ * steady state hit ratio without waiting for organic traffic.
+ * Rotating or truncating the log file is left to the deployment.
  */
 
 #ifndef __GET_BOOK_INFO_TABLE__
@@ -22,9 +30,22 @@
 #define __BOOK_INFO_TABLE_SIZE 500 // N: number of recent look ups.
 
 
+#include<stdio.h>
+#include<stdint.h>
+#ifdef _WIN32
+#include<io.h>
+#else
+#include<unistd.h>
+#endif
 #include<iostream>
 #include<map>
 #include<string>
+#include<vector>
+#include<unordered_map>
+#include<algorithm>
+#include<atomic>
+#include<thread>
+#include<chrono>
 
 using namespace std;
 
@@ -78,6 +99,124 @@ TBookInfo retreive_from_database(string isbn) {
     return temp;
 }
 
+/******************************************************************************
+ * @brief Batched database path, used by the cache warmer so that replayed keys
+ *          are fetched in one round trip per batch.
+ * 
+ * @param isbns 
+ * @return vector<TBookInfo> one record per isbn, in the same order.
+ */
+vector<TBookInfo> retreive_from_database_batch(const vector<string>& isbns) {
+
+    // Querying for all book infos in one request, e.g. WHERE isbn IN (...).
+    // .....
+
+    // following is a mockup for unit testing.
+    vector<TBookInfo> records;
+    records.reserve(isbns.size());
+    for (auto& isbn : isbns) {
+        records.push_back(retreive_from_database(isbn));
+    }
+    return records;
+}
+
+/******************************************************************************
+ * @brief Access log record, 12 bytes on disk.
+ *          ISBNs are packed 4 bits per character ('0'-'9' as 1-10, 'X' as 11),
+ *          so up to 16 characters fit into isbn; 0 ends the string.
+ */
+#define __ACCESS_LOG_RING_SIZE__        (1 << 16) // records, must be a power of two.
+#define __ACCESS_LOG_MAX_ISBN_LENGTH__  16
+
+#pragma pack(push, 1)
+struct TAccessRecord {
+    uint64_t isbn;
+    uint32_t timestamp; // seconds since epoch.
+};
+#pragma pack(pop)
+
+bool pack_isbn(const string& isbn, uint64_t& packed);
+bool is_packed_isbn(uint64_t packed);
+string unpack_isbn(uint64_t packed);
+
+/******************************************************************************
+ * @brief Asynchronous access log.
+ *          record() is called from the lookup path and only writes into a single
+ *          producer / single consumer ring buffer; it never blocks, and drops the
+ *          record when the ring is full (see dropped()). A writer thread drains the
+ *          ring into the log file; records it fails to write are counted in write_errors().
+ *          Like the lookup table itself, record() must only be called from one thread.
+ */
+class TAccessLog {
+    private:
+        TAccessRecord ring[__ACCESS_LOG_RING_SIZE__];
+        atomic<size_t> head{0}; // next slot written by record().
+        atomic<size_t> tail{0}; // next slot written to the file.
+        atomic<bool> running{false};
+        atomic<uint32_t> clock_seconds{0}; // refreshed by the writer, saves a clock call per record.
+        size_t dropped_records = 0;
+        atomic<size_t> unwritten_records{0}; // lost to write errors, counted by the writer.
+
+        FILE* file = NULL;
+        thread writer;
+
+        void drain();
+        bool align_file();
+
+        static uint32_t now_seconds() {
+            return (uint32_t)chrono::duration_cast<chrono::seconds>(
+                chrono::system_clock::now().time_since_epoch()).count();
+        }
+
+    public:
+        ~TAccessLog() {
+            close();
+        }
+
+        bool open(string path);
+        void close();
+        bool is_open() { return file != NULL; }
+        size_t dropped() { return dropped_records; }
+        size_t write_errors() { return unwritten_records.load(memory_order_relaxed); }
+
+        void record(const string& isbn) {
+            TAccessRecord entry;
+            if (!pack_isbn(isbn, entry.isbn)) return;
+
+            size_t position = head.load(memory_order_relaxed);
+            if (position - tail.load(memory_order_acquire) == __ACCESS_LOG_RING_SIZE__) {
+                dropped_records++;
+                return;
+            }
+            entry.timestamp = clock_seconds.load(memory_order_relaxed);
+            ring[position & (__ACCESS_LOG_RING_SIZE__ - 1)] = entry;
+            head.store(position + 1, memory_order_release);
+        }
+};
+
+/******************************************************************************
+ * @brief The lookup table and access log shared by get_book_info() and the
+ *          cache warmer.
+ *          static local variable approach to limit access to the lookup table.
+ */
+TLookupTable& book_info_table() {
+    static TLookupTable _book_info_queue(__BOOK_INFO_TABLE_SIZE);
+    return _book_info_queue;
+}
+
+TAccessLog& book_info_access_log() {
+    static TAccessLog _book_info_access_log;
+    return _book_info_access_log;
+}
+
+bool enable_book_info_access_log(string path) {
+    return book_info_access_log().open(path);
+}
+
+void disable_book_info_access_log() {
+    book_info_access_log().close();
+}
+
 /******************************************************************************
  * @brief Required wrapper function that boosts performance of 
  *          retrieve_from_database() function.
@@ -86,8 +225,11 @@ TBookInfo retreive_from_database(string isbn) {
  * @return TBookInfo 
  */
 TBookInfo get_book_info(string isbn) {
-    static TLookupTable _book_info_queue(__BOOK_INFO_TABLE_SIZE);
-                // static local variable approach to limit access to to lookup table
+    auto& _book_info_queue = book_info_table();
+    auto& access_log = book_info_access_log();
+    if (access_log.is_open()) {
+        access_log.record(isbn);
+    }
 
     // From the lookup Table
     auto result = _book_info_queue.search(isbn);
@@ -102,6 +244,89 @@ TBookInfo get_book_info(string isbn) {
     }
 }
 
+/******************************************************************************
+ * @brief Predictive cache warming. Replays the top_k most frequent and the top_k
+ *          most recent keys of an access log through retreive_from_database_batch(),
+ *          fetching at most keys_per_second keys per second so a warming instance
+ *          does not spike the database. Keys are appended from coldest to hottest,
+ *          so the hottest keys are the last to be dequeued. Call at startup, before
+ *          serving lookups; it blocks until warming is done.
+ * 
+ * @param log_path access log written by enable_book_info_access_log().
+ * @param top_k number of keys taken from each list, at most half the table size.
+ * @param keys_per_second database fetch rate limit.
+ * @return int number of records loaded into the lookup table, -1 if the log cannot be read.
+ */
+int warm_book_info_cache(string log_path, size_t top_k, size_t keys_per_second) {
+    FILE* log = fopen(log_path.c_str(), "rb");
+    if (log == NULL) return -1;
+
+    struct TKeyStats {
+        uint64_t isbn;
+        size_t count;
+        uint32_t last_seen;
+    };
+    unordered_map<uint64_t, TKeyStats> stats;
+    TAccessRecord entries[1024];
+    size_t n;
+    while ((n = fread(entries, sizeof(TAccessRecord), 1024, log)) > 0) {
+        for (size_t i = 0; i < n; i++) {
+            if (!is_packed_isbn(entries[i].isbn)) continue; // corrupted record.
+            auto& key = stats[entries[i].isbn];
+            key.isbn = entries[i].isbn;
+            key.count++;
+            key.last_seen = max(key.last_seen, entries[i].timestamp);
+        }
+    }
+    fclose(log);
+
+    vector<TKeyStats> keys;
+    keys.reserve(stats.size());
+    for (auto& key : stats) keys.push_back(key.second);
+    if (top_k > __BOOK_INFO_TABLE_SIZE / 2) top_k = __BOOK_INFO_TABLE_SIZE / 2; // both lists must fit.
+    size_t frequent = min(top_k, keys.size());
+
+    // top_k by frequency, then top_k by recency among the rest.
+    partial_sort(keys.begin(), keys.begin() + frequent, keys.end(),
+        [](const TKeyStats& a, const TKeyStats& b) { return a.count > b.count; });
+    size_t recent = min(top_k, keys.size() - frequent);
+    partial_sort(keys.begin() + frequent, keys.begin() + frequent + recent, keys.end(),
+        [](const TKeyStats& a, const TKeyStats& b) { return a.last_seen > b.last_seen; });
+    keys.resize(frequent + recent);
+
+    // coldest first, so the hottest keys survive the longest in the queue.
+    sort(keys.begin(), keys.end(), [](const TKeyStats& a, const TKeyStats& b) {
+        return a.last_seen != b.last_seen ? a.last_seen < b.last_seen : a.count < b.count;
+    });
+
+    auto& table = book_info_table();
+    vector<string> pending;
+    for (auto& key : keys) {
+        string isbn = unpack_isbn(key.isbn);
+        if (table.search(isbn) == NULL) pending.push_back(isbn);
+    }
+
+    // rate limit: one batch per tick, keys_per_second / 10 keys per batch.
+    if (keys_per_second == 0) keys_per_second = 1;
+    size_t batch_size = keys_per_second >= 10 ? keys_per_second / 10 : 1;
+    auto tick = chrono::microseconds(1000000 * batch_size / keys_per_second);
+    auto next_tick = chrono::steady_clock::now();
+
+    int warmed = 0;
+    for (size_t begin = 0; begin < pending.size(); begin += batch_size) {
+        this_thread::sleep_until(next_tick);
+        next_tick += tick;
+
+        size_t end = min(begin + batch_size, pending.size());
+        vector<string> batch(pending.begin() + begin, pending.begin() + end);
+        for (auto& record : retreive_from_database_batch(batch)) {
+            table.append(record);
+            warmed++;
+        }
+    }
+    return warmed;
+}
+
 /******************************************************************************
  * Type LookupTable Member Function Implementations.
  */
@@ -133,4 +358,116 @@ void TLookupTable::append(TBookInfo book_info) {
     }
 }
 
+/******************************************************************************
+ * Type AccessLog Member Function and ISBN Packing Implementations.
+ */
+
+bool pack_isbn(const string& isbn, uint64_t& packed) {
+    if (isbn.empty() || isbn.size() > __ACCESS_LOG_MAX_ISBN_LENGTH__) return false;
+
+    packed = 0;
+    for (size_t i = 0; i < isbn.size(); i++) {
+        uint64_t code;
+        if (isbn[i] >= '0' && isbn[i] <= '9') code = isbn[i] - '0' + 1;
+        else if (isbn[i] == 'X' || isbn[i] == 'x') code = 11;
+        else return false; // not an ISBN, not logged.
+        packed |= code << (4 * i);
+    }
+    return true;
+}
+
+// true if packed could have come from pack_isbn(): codes 1-11, then only 0s.
+bool is_packed_isbn(uint64_t packed) {
+    if (packed == 0) return false;
+    for (; packed; packed >>= 4) {
+        uint64_t code = packed & 0xf;
+        if (code < 1 || code > 11) return false;
+    }
+    return true;
+}
+
+string unpack_isbn(uint64_t packed) {
+    string isbn;
+    for (; packed; packed >>= 4) {
+        uint64_t code = packed & 0xf;
+        isbn += code == 11 ? 'X' : (char)('0' + code - 1);
+    }
+    return isbn;
+}
+
+bool TAccessLog::open(string path) {
+    if (file) return false;
+    file = fopen(path.c_str(), "ab");
+    if (file == NULL) return false;
+
+    // a crash mid-write can leave a partial record at the end.
+    if (!align_file()) {
+        fclose(file);
+        file = NULL;
+        return false;
+    }
+
+    clock_seconds = now_seconds();
+    running = true;
+    writer = thread([this]() {
+        while (running.load(memory_order_acquire)) {
+            clock_seconds.store(now_seconds(), memory_order_relaxed);
+            drain();
+            this_thread::sleep_for(chrono::milliseconds(10));
+        }
+        drain(); // whatever was recorded before close().
+    });
+    return true;
+}
+
+void TAccessLog::close() {
+    if (file == NULL) return;
+    running.store(false, memory_order_release);
+    writer.join();
+    fclose(file);
+    file = NULL;
+}
+
+// truncates the file down to whole records, so the records appended next stay aligned.
+bool TAccessLog::align_file() {
+    fflush(file);
+    if (fseek(file, 0, SEEK_END) != 0) return false;
+    long size = ftell(file);
+    if (size < 0) return false;
+    long aligned = size - size % sizeof(TAccessRecord);
+    if (aligned == size) return true;
+#ifdef _WIN32
+    return _chsize_s(_fileno(file), aligned) == 0;
+#else
+    return ftruncate(fileno(file), aligned) == 0;
+#endif
+}
+
+// writes everything between tail and head; runs on the writer thread only.
+// Records that fail to reach the file are counted in write_errors(), and the file is
+// realigned in case a partial record made it out.
+void TAccessLog::drain() {
+    size_t position = tail.load(memory_order_relaxed);
+    size_t end = head.load(memory_order_acquire);
+    if (position == end) return;
+
+    size_t total = end - position;
+    size_t written = 0;
+    while (position != end) {
+        size_t index = position & (__ACCESS_LOG_RING_SIZE__ - 1);
+        size_t count = min(end - position, __ACCESS_LOG_RING_SIZE__ - index); // up to the wrap.
+        written += fwrite(&ring[index], sizeof(TAccessRecord), count, file);
+        position += count;
+    }
+    tail.store(position, memory_order_release);
+
+    // a failed flush loses whatever was still buffered, so count the whole batch.
+    if (fflush(file) != 0) written = 0;
+    if (written < total) {
+        unwritten_records.fetch_add(total - written, memory_order_relaxed);
+        clearerr(file);
+        align_file();
+    }
+}
+
 #endif
\ No newline at end of file
@@ -0,0 +1,96 @@
+/******************************************************************************
+ * @file picovoice_Q1_bench.c
+ * @author Yong Sung John Lee (yongjohnlee80@outlook.com)
+ * @brief ns/lookup of the hot/cold cache layout against whole records, and of
+ *        get_book_info() against get_book_info_batch().
+ * @version 0.1
+ * @date 2022-04-08
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * Fills the cache with N random ISBNs, then times random hits, one lookup at a time
+ * and in batches. N defaults to 1M records (~48 MiB of hot index, ~80 MiB of payload),
+ * well beyond L2, and can be changed at compile time.
+ * Build it a second time with __BOOK_INFO_AOS_LAYOUT__ for the baseline: 96 byte
+ * TBookInfo records probed through the same bucket index, so the two binaries only
+ * differ in where keys and payloads live.
+ *
+ * Build & run (Linux):
+ *      gcc -O2 -o q1_bench picovoice_Q1_bench.c
+ *      gcc -O2 -D__BOOK_INFO_AOS_LAYOUT__ -o q1_bench_aos picovoice_Q1_bench.c
+ *      gcc -O2 -D__BOOK_INFO_RECORD_MAX_SIZE__=100000 -o q1_bench picovoice_Q1_bench.c
+ *      ./q1_bench [lookups=4000000] [batch_size=64]
+ *      ./q1_bench_aos [lookups=4000000] [batch_size=64]
+ */
+
+#define __BOOK_INFO_LIBRARY__
+#ifndef __BOOK_INFO_RECORD_MAX_SIZE__
+#define __BOOK_INFO_RECORD_MAX_SIZE__   (1 << 20)
+#endif
+#include "picovoice_Q1.c"
+
+#include <time.h>
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// xorshift64, deterministic across runs.
+static unsigned long long next_random(unsigned long long* state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+int main(int argc, char** argv) {
+    int lookups = argc > 1 ? atoi(argv[1]) : 4000000;
+    int batch_size = argc > 2 ? atoi(argv[2]) : 64;
+    unsigned long long state = 0x9e3779b97f4a7c15ULL;
+
+    // random 13 digit ISBNs, all resident in the cache.
+    char (*isbns)[__BOOK_INFO_ISBN_LENGTH__] = malloc((size_t)__BOOK_INFO_RECORD_MAX_SIZE__ * __BOOK_INFO_ISBN_LENGTH__);
+    for(int i = 0; i < __BOOK_INFO_RECORD_MAX_SIZE__; i++) {
+        sprintf(isbns[i], "978%010llu", next_random(&state) % 10000000000ULL);
+        get_book_info(isbns[i]);
+    }
+
+    char** queries = malloc(sizeof(char*) * lookups);
+    for(int i = 0; i < lookups; i++) {
+        queries[i] = isbns[next_random(&state) % __BOOK_INFO_RECORD_MAX_SIZE__];
+    }
+    TBookInfo* records = malloc(sizeof(TBookInfo) * batch_size);
+    unsigned checksum = 0;
+
+    double start = now_seconds();
+    for(int i = 0; i < lookups; i++) {
+        TBookInfo record = get_book_info(queries[i]);
+        checksum += record.isbn[12];
+    }
+    double single_time = now_seconds() - start;
+
+    start = now_seconds();
+    for(int i = 0; i < lookups; i += batch_size) {
+        int count = lookups - i < batch_size ? lookups - i : batch_size;
+        get_book_info_batch(&queries[i], count, records);
+        for(int j = 0; j < count; j++) checksum -= records[j].isbn[12];
+    }
+    double batch_time = now_seconds() - start;
+
+#ifdef __BOOK_INFO_AOS_LAYOUT__
+    const char* layout = "whole records (baseline)";
+#else
+    const char* layout = "hot/cold split";
+#endif
+    printf("%s layout, %d records, %d random hits (checksum %s)\n", layout,
+        __BOOK_INFO_RECORD_MAX_SIZE__, lookups, checksum ? "BAD" : "ok");
+    printf("get_book_info        %8.2f ns/lookup\n", single_time * 1e9 / lookups);
+    printf("get_book_info_batch  %8.2f ns/lookup (batches of %d)\n", batch_time * 1e9 / lookups, batch_size);
+
+    free(records);
+    free(queries);
+    free(isbns);
+    return 0;
+}
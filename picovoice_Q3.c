@@ -111,6 +111,7 @@ void clear_orphans(PTStack stack); // frees allocated memory resources of popped
 void stack_push(PTStack stack, void* data, size_t data_size);
 void* stack_pop(PTStack stack);
 
+#ifndef __TSTACK_LIBRARY__ // define to link the stack functions without the demo (see picovoice_Q3_bench.cpp).
 /******************************************************************************
  * Testing implemented stack class (struct with functions) 
  * with custom complex data structure.
@@ -164,6 +165,7 @@ int main() {
     kill_stack(my_stack);
     return 0;
 }
+#endif
 
 /******************************************************************************
  * @brief TStack function implemenations.
@@ -209,6 +211,7 @@ void clear_orphans(PTStack stack) {
         orphan = orphan->next;
         free(temp);
     }
+    stack->orphan = NULL; // safe to keep pushing and popping afterwards.
 }
 
 void stack_push(PTStack stack, void* data, size_t data_size) {
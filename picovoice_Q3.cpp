@@ -11,9 +11,16 @@
  * allow storing any data type including complex structures. Describe different implementation strategies and
  * compare their pros and cons. What is the best approach in an embedded real-time system? What is the
  * best approach when memory resources are very limited? You can use “malloc” and “free” functions.
+ *
+ * Define __TSTACK_LIBRARY__ before including this file to use TStack and TSpillStack
+ * without the demo main() (see picovoice_Q3_bench.cpp).
  */
 
+#ifndef __TSTACK_CLASS__
+#define __TSTACK_CLASS__
+
 #include<stdlib.h>
+#include<string.h>
 #include<string>
 #include<exception>
 #include<iostream>
@@ -89,7 +96,7 @@ class TStack {
             while (orphan) {
                 auto temp = orphan;
                 orphan = orphan->next;
-                free(temp);
+                delete temp; // ~TNode() frees the data block as well.
             }
         }
 
@@ -114,6 +121,326 @@ class TStack {
         }
 };
 
+#ifndef _WIN32
+#include<vector>
+#include<errno.h>
+#include<fcntl.h>
+#include<unistd.h>
+#include<sys/mman.h>
+
+#define __SPILL_SEGMENT_SIZE__      (1 << 20) // 1 MiB per segment.
+#define __SPILL_NO_SEGMENT__        ((size_t)-1)
+
+/******************************************************************************
+ *
+ * @brief TSpillStack keeps the same push/pop interface as TStack, but stores
+ *          records back to back in 1 MiB segments instead of one malloc per node.
+ *          Only the top ram_budget bytes of segments stay in memory; colder segments
+ *          below them are appended to an unlinked temp file with plain sequential
+ *          writes, so the file itself behaves like a stack.
+ *          When the stack unwinds into the spilled region, the next segment is
+ *          mapped with mmap and madvise(MADV_WILLNEED) one segment ahead of time,
+ *          so the kernel reads it back while the current segment is still being
+ *          popped. Reloaded segments are truncated off the end of the file.
+ *          To avoid thrashing when the top oscillates around a segment boundary,
+ *          an emptied top segment is kept as a spare for the next push, and
+ *          spilled segments are only reloaded once no resident segment is left,
+ *          or the resident records drop below a low-water mark two segments
+ *          beneath the budget.
+ *          A push() or pop() that throws (spill file or memory failure) leaves the
+ *          stack unchanged, so the caller can retry or unwind.
+ *
+ *          Each record is laid out as [data, padded to 8 bytes][size_t data_size],
+ *          so pop() reads the size from the top and walks down.
+ *          Unlike TStack there is no orphan history, since keeping every popped node
+ *          would defeat the memory bound; pop() copies the record into an internal
+ *          buffer instead, which stays valid until the next pop() or clear_orphans().
+ */
+class TSpillStack {
+    private:
+        struct TSegment {
+            char* data;         // NULL while the segment lives in the spill file.
+            size_t capacity;
+            size_t used;
+            off_t file_offset;  // valid while spilled.
+        };
+
+        vector<TSegment> segments;
+        size_t first_resident = 0; // segments below this index are spilled.
+        size_t resident_bytes = 0; // includes the spare.
+        size_t ram_budget;
+        size_t low_water;
+
+        char* spare = NULL; // emptied top segment, reused by the next new_segment().
+
+        string spill_dir;
+        int spill_fd = -1;
+        off_t spill_file_size = 0;
+        size_t page_size;
+
+        // read-ahead mapping of the next segment to be reloaded.
+        size_t prefetch_segment = __SPILL_NO_SEGMENT__;
+        char* prefetch_map = NULL;
+        size_t prefetch_length = 0;
+
+        char* pop_buffer = NULL;
+        size_t pop_buffer_size = 0;
+
+        size_t reload_count = 0;
+        size_t prefetched_reload_count = 0; // reloads that found their read-ahead mapping.
+
+        static size_t record_size(size_t data_size) {
+            return ((data_size + 7) & ~(size_t)7) + sizeof(size_t);
+        }
+
+        void open_spill_file() {
+            string path = spill_dir + "/tstack_spill_XXXXXX";
+            spill_fd = mkstemp(&path[0]);
+            if (spill_fd < 0) throw "Spill File Error";
+            unlink(path.c_str()); // the file disappears with the descriptor.
+        }
+
+        // returns a buffer of capacity bytes, taking the spare when it fits.
+        char* allocate_segment(size_t capacity) {
+            if (spare && capacity == __SPILL_SEGMENT_SIZE__) {
+                char* data = spare;
+                spare = NULL;
+                return data; // already counted in resident_bytes.
+            }
+            char* data = (char*)malloc(capacity);
+            if (data == NULL) throw "Out Of Memory";
+            resident_bytes += capacity;
+            return data;
+        }
+
+        void free_spare() {
+            if (spare == NULL) return;
+            free(spare);
+            spare = NULL;
+            resident_bytes -= __SPILL_SEGMENT_SIZE__;
+        }
+
+        // gives back a buffer from allocate_segment() that was not used.
+        void release_segment(char* data, size_t capacity) {
+            if (spare == NULL && capacity == __SPILL_SEGMENT_SIZE__) {
+                spare = data; // stays counted in resident_bytes.
+            } else {
+                free(data);
+                resident_bytes -= capacity;
+            }
+        }
+
+        void new_segment(size_t min_capacity) {
+            TSegment segment;
+            segment.capacity = min_capacity > __SPILL_SEGMENT_SIZE__ ? min_capacity : __SPILL_SEGMENT_SIZE__;
+            segment.data = allocate_segment(segment.capacity);
+            segment.used = 0;
+            segment.file_offset = 0;
+
+            // make room before the new segment becomes the top, so a failed spill
+            // leaves the stack exactly as it was.
+            try {
+                if (resident_bytes > ram_budget) free_spare();
+                while (resident_bytes > ram_budget && first_resident < segments.size()) {
+                    spill(first_resident);
+                    first_resident++; // only once the segment is safely on disk.
+                }
+                segments.push_back(segment);
+            }
+            catch (...) {
+                release_segment(segment.data, segment.capacity);
+                throw;
+            }
+        }
+
+        void spill(size_t index) {
+            if (spill_fd < 0) open_spill_file();
+
+            TSegment& segment = segments[index];
+            size_t written = 0;
+            while (written < segment.used) {
+                ssize_t n = pwrite(spill_fd, segment.data + written, segment.used - written,
+                    spill_file_size + written);
+                if (n < 0 && errno == EINTR) continue;
+                if (n <= 0) throw "Spill File Error";
+                written += n;
+            }
+            segment.file_offset = spill_file_size;
+            spill_file_size += segment.used;
+
+            free(segment.data);
+            segment.data = NULL;
+            resident_bytes -= segment.capacity;
+        }
+
+        // maps a spilled segment and asks the kernel to start reading it in.
+        void prefetch(size_t index) {
+            if (prefetch_segment == index) return;
+            drop_prefetch();
+
+            TSegment& segment = segments[index];
+            off_t aligned = segment.file_offset & ~(off_t)(page_size - 1);
+            size_t length = segment.used + (segment.file_offset - aligned);
+            void* map = mmap(NULL, length, PROT_READ, MAP_PRIVATE, spill_fd, aligned);
+            if (map == MAP_FAILED) throw "Spill File Error";
+            madvise(map, length, MADV_SEQUENTIAL);
+            madvise(map, length, MADV_WILLNEED);
+
+            prefetch_segment = index;
+            prefetch_map = (char*)map;
+            prefetch_length = length;
+        }
+
+        void drop_prefetch() {
+            if (prefetch_map) munmap(prefetch_map, prefetch_length);
+            prefetch_segment = __SPILL_NO_SEGMENT__;
+            prefetch_map = NULL;
+            prefetch_length = 0;
+        }
+
+        // either the segment is resident afterwards, or it throws with nothing changed.
+        void reload(size_t index) {
+            bool prefetched = prefetch_segment == index;
+            prefetch(index); // no-op when it was already prefetched.
+
+            TSegment& segment = segments[index];
+            char* data = allocate_segment(segment.capacity);
+            memcpy(data, prefetch_map + (prefetch_length - segment.used), segment.used);
+            segment.data = data;
+            drop_prefetch();
+
+            reload_count++;
+            if (prefetched) prefetched_reload_count++;
+
+            // the reloaded segment was the last one appended to the file. Truncating
+            // only gives the disk space back; later spills overwrite from here anyway.
+            spill_file_size = segment.file_offset;
+            if (ftruncate(spill_fd, spill_file_size) != 0) {}
+        }
+
+        // the segment below the top must already be resident (see pop()).
+        void release_top_segment() {
+            release_segment(segments.back().data, segments.back().capacity);
+            segments.pop_back();
+
+            // the stack is consistent from here on, so a failed reload or read-ahead
+            // is not an error for this pop; it is simply retried by a later one.
+            try {
+                // refill from the spill file, top first, below the low-water mark.
+                while (first_resident > 0) {
+                    size_t resident_records = resident_bytes - (spare ? __SPILL_SEGMENT_SIZE__ : 0);
+                    if (resident_records >= low_water ||
+                            resident_records + segments[first_resident - 1].capacity > ram_budget) break;
+
+                    reload(first_resident - 1);
+                    first_resident--;
+                }
+
+                // read ahead the next segment to be reloaded.
+                if (first_resident > 0) prefetch(first_resident - 1);
+            }
+            catch (const char*) {}
+        }
+
+    public:
+        /**
+         * @param ram_budget_mib number of MiB kept in memory before spilling.
+         * @param spill_dir directory for the temp file, created on the first spill.
+         */
+        TSpillStack(size_t ram_budget_mib = 64, const char* spill_dir = "/tmp") {
+            ram_budget = ram_budget_mib << 20;
+            if (ram_budget < 2 * __SPILL_SEGMENT_SIZE__) ram_budget = 2 * __SPILL_SEGMENT_SIZE__;
+            low_water = ram_budget - 2 * __SPILL_SEGMENT_SIZE__;
+            this->spill_dir = spill_dir;
+            page_size = sysconf(_SC_PAGESIZE);
+        }
+
+        TSpillStack(const TSpillStack&) = delete;
+        TSpillStack& operator=(const TSpillStack&) = delete;
+
+        ~TSpillStack() {
+            clear_stack();
+            if (spill_fd >= 0) close(spill_fd);
+        }
+
+        bool is_empty() { return segments.empty(); }
+
+        size_t spilled_bytes() { return spill_file_size; }
+        size_t reloads() { return reload_count; }
+        size_t prefetched_reloads() { return prefetched_reload_count; }
+
+        // never throws, since the destructor relies on it.
+        void clear_stack() {
+            drop_prefetch();
+            for (auto& segment : segments) {
+                if (segment.data) free(segment.data);
+            }
+            segments.clear();
+            first_resident = 0;
+            free(spare);
+            spare = NULL;
+            resident_bytes = 0;
+            if (spill_fd >= 0 && spill_file_size > 0) {
+                spill_file_size = 0;
+                if (ftruncate(spill_fd, 0) != 0) {} // only the disk space is lost.
+            }
+            clear_orphans();
+        }
+
+        // invalidates the pointer returned by the last pop().
+        void clear_orphans() {
+            free(pop_buffer);
+            pop_buffer = NULL;
+            pop_buffer_size = 0;
+        }
+
+        void push(void* data, size_t data_size) {
+            size_t needed = record_size(data_size);
+            if (segments.empty() || segments.back().capacity - segments.back().used < needed) {
+                new_segment(needed);
+            }
+
+            TSegment& segment = segments.back();
+            memcpy(segment.data + segment.used, data, data_size);
+            segment.used += needed;
+            memcpy(segment.data + segment.used - sizeof(size_t), &data_size, sizeof(size_t));
+        }
+
+        // on an exception the record stays on the stack.
+        void* pop() {
+            if (is_empty()) throw "Empty Stack";
+
+            size_t data_size;
+            memcpy(&data_size, segments.back().data + segments.back().used - sizeof(size_t), sizeof(size_t));
+            size_t needed = record_size(data_size);
+
+            if (data_size > pop_buffer_size) {
+                char* buffer = (char*)realloc(pop_buffer, data_size);
+                if (buffer == NULL) throw "Out Of Memory";
+                pop_buffer = buffer;
+                pop_buffer_size = data_size;
+            }
+
+            // emptying the last resident segment: bring the one below back first.
+            bool emptied = segments.back().used == needed;
+            if (emptied && first_resident > 0 && first_resident + 1 == segments.size()) {
+                reload(first_resident - 1);
+                first_resident--;
+            }
+
+            TSegment& segment = segments.back();
+            segment.used -= needed;
+            memcpy(pop_buffer, segment.data + segment.used, data_size);
+
+            if (emptied) release_top_segment();
+            return pop_buffer;
+        }
+};
+#endif // _WIN32
+
+#endif // __TSTACK_CLASS__
+
+#ifndef __TSTACK_LIBRARY__
 /******************************************************************************
  * Testing the TStack data strucrure with complex data type, TMyCustom.
  * 
@@ -152,4 +479,5 @@ int main() {
         TMyCustom* item = (TMyCustom*)my_stack.pop();
         printf("Popped item #%d: integer(%d) real_number(%.2f) letter(%c)\n", count--, item->a, item->b, item->c);
     }
-}
\ No newline at end of file
+}
+#endif // __TSTACK_LIBRARY__
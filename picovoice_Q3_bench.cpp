@@ -0,0 +1,427 @@
+/******************************************************************************
+ * @file picovoice_Q3_bench.cpp
+ * @author Yong Sung John Lee (yongjohnlee80@outlook.com)
+ * @brief Benchmark and allocation-profiling suite for the Q3 stacks.
+ * @version 0.2
+ * @date 2022-04-08
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * Backends:
+ *      c_stack     stack_push/stack_pop from picovoice_Q3.c
+ *      TStack      linked list class from picovoice_Q3.cpp
+ *      TSpillStack segment stack with disk spill from picovoice_Q3.cpp
+ *
+ * Workloads (N = working set / element size):
+ *      push_heavy  N pushes onto an empty stack.
+ *      pop_heavy   N pops from a stack prefilled with N records.
+ *      sawtooth    16 teeth of N/8 pushes followed by N/16 pops, ending N deep.
+ *      mixed       N random push/pop (50/50) on a stack prefilled with N/2 records.
+ *
+ * Element sizes run from 8 B to 4 KiB. For every (backend, workload, size) run the
+ * suite reports ns/op, throughput, malloc calls per op, peak RSS and cache misses.
+ * Each run is forked into its own child so ru_maxrss only covers that run; prefill
+ * and cleanup happen outside the measured section.
+ * malloc/calloc/realloc are interposed below to count calls (glibc only), and cache
+ * misses come from perf_event_open when the kernel allows it. Unavailable metrics
+ * are shown as "-" in the table and null in JSON.
+ * TSpillStack runs also report how many segment reloads found their read-ahead
+ * mapping; an unwind (pop_heavy) that reloads without it counts as a failed run.
+ * A run that throws or whose child dies is still reported, with "ok": false and the
+ * exception, exit status or signal in "error", and the suite exits with status 1.
+ *
+ * Build & run (Linux):
+ *      gcc -O2 -D__TSTACK_LIBRARY__ -c picovoice_Q3.c -o picovoice_Q3.o
+ *      g++ -std=c++11 -O2 -o q3_bench picovoice_Q3_bench.cpp picovoice_Q3.o
+ *      ./q3_bench [--json] [--mib 64] [--spill-budget 16]
+ */
+
+#define __TSTACK_LIBRARY__
+#include "picovoice_Q3.cpp"
+
+#include<stdio.h>
+#include<stdint.h>
+#include<time.h>
+#include<sys/ioctl.h>
+#include<sys/resource.h>
+#include<sys/syscall.h>
+#include<sys/wait.h>
+#include<signal.h>
+#include<linux/perf_event.h>
+
+/******************************************************************************
+ * @brief C stack API from picovoice_Q3.c. struct TStack there clashes with the
+ *        C++ class of the same name, so it is declared as an opaque type here.
+ */
+extern "C" {
+    struct TCStack;
+    TCStack* create_stack();
+    void kill_stack(TCStack* stack);
+    int is_stack_empty(TCStack* stack);
+    void clear_orphans(TCStack* stack);
+    void stack_push(TCStack* stack, void* data, size_t data_size);
+    void* stack_pop(TCStack* stack);
+}
+
+/******************************************************************************
+ * @brief Counting allocator. Interposes the libc entry points so that every
+ *        allocation, including operator new, is counted.
+ */
+static size_t malloc_calls = 0;
+
+#ifdef __GLIBC__
+#define __COUNTING_ALLOCATOR__
+extern "C" {
+    void* __libc_malloc(size_t size);
+    void* __libc_calloc(size_t count, size_t size);
+    void* __libc_realloc(void* ptr, size_t size);
+    void __libc_free(void* ptr);
+
+    void* malloc(size_t size) { malloc_calls++; return __libc_malloc(size); }
+    void* calloc(size_t count, size_t size) { malloc_calls++; return __libc_calloc(count, size); }
+    void* realloc(void* ptr, size_t size) { malloc_calls++; return __libc_realloc(ptr, size); }
+    void free(void* ptr) { __libc_free(ptr); }
+}
+#endif
+
+/******************************************************************************
+ * @brief Hardware cache-miss counter. open() returns false when perf events are
+ *        unavailable (no PMU, container, perf_event_paranoid).
+ */
+class TCacheMissCounter {
+    private:
+        int fd = -1;
+
+    public:
+        ~TCacheMissCounter() {
+            if (fd >= 0) close(fd);
+        }
+
+        bool open() {
+            struct perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_CACHE_MISSES;
+            attr.disabled = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+            return fd >= 0;
+        }
+
+        void start() {
+            if (fd < 0) return;
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+
+        long long stop() {
+            if (fd < 0) return -1;
+            ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+            long long count;
+            if (read(fd, &count, sizeof(count)) != sizeof(count)) return -1;
+            return count;
+        }
+};
+
+/******************************************************************************
+ * @brief Backend adapters, all exposing the TStack interface.
+ */
+struct TCStackBackend {
+    TCStack* stack;
+
+    TCStackBackend() { stack = create_stack(); }
+    ~TCStackBackend() { kill_stack(stack); }
+
+    bool is_empty() { return is_stack_empty(stack); }
+    void push(void* data, size_t data_size) { stack_push(stack, data, data_size); }
+    void* pop() { return stack_pop(stack); }
+    void clear_orphans() { ::clear_orphans(stack); }
+};
+
+size_t spill_budget_mib = 16;
+
+struct TSpillBackend : TSpillStack {
+    TSpillBackend() : TSpillStack(spill_budget_mib) {}
+};
+
+template<typename T>
+static void read_reload_stats(T&, long long& reloads, long long& prefetched) {
+    reloads = prefetched = -1;
+}
+
+static void read_reload_stats(TSpillBackend& stack, long long& reloads, long long& prefetched) {
+    reloads = stack.reloads();
+    prefetched = stack.prefetched_reloads();
+}
+
+/******************************************************************************
+ * @brief Result of one (backend, workload, element size) run, sent from the
+ *        forked child back to the parent through a pipe.
+ */
+struct TResult {
+    size_t ops;
+    double seconds;
+    long long malloc_calls;  // -1 when not counted.
+    long peak_rss_kib;
+    long long cache_misses;  // -1 when unavailable.
+    long long reloads;       // TSpillStack only, -1 otherwise.
+    long long prefetched_reloads;
+    bool ok;
+    char error[96];          // why the run failed, when !ok.
+};
+
+const char* workloads[] = { "push_heavy", "pop_heavy", "sawtooth", "mixed" };
+const char* backends[] = { "c_stack", "TStack", "TSpillStack" };
+const size_t element_sizes[] = { 8, 64, 512, 4096 };
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// xorshift64, so the mixed workload is identical for every backend.
+static uint64_t next_random(uint64_t& state) {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+template<typename T>
+static void fill(T& stack, char* element, size_t element_size, size_t count) {
+    for (size_t i = 0; i < count; i++) stack.push(element, element_size);
+}
+
+template<typename T>
+static void drain(T& stack) {
+    while (!stack.is_empty()) stack.pop();
+    stack.clear_orphans();
+}
+
+/******************************************************************************
+ * @brief Runs one workload against backend T and returns its measurements.
+ *
+ * @param workload index into workloads[].
+ * @param count N, the number of records in the working set.
+ */
+template<typename T>
+TResult run_workload(int workload, size_t element_size, size_t count) {
+    TResult result;
+    memset(&result, 0, sizeof(result));
+    result.ok = true;
+
+    char* element = (char*)malloc(element_size);
+    memset(element, 0x5a, element_size);
+    volatile char sink = 0; // keeps popped data live.
+
+    TCacheMissCounter counter;
+    bool counting_misses = counter.open();
+
+    T stack;
+    if (workload == 1) fill(stack, element, element_size, count);
+    if (workload == 3) fill(stack, element, element_size, count / 2);
+
+    size_t calls_before = malloc_calls;
+    counter.start();
+    double start = now_seconds();
+
+    switch (workload) {
+        case 0: // push_heavy
+            fill(stack, element, element_size, count);
+            result.ops = count;
+            break;
+
+        case 1: // pop_heavy
+            for (size_t i = 0; i < count; i++) sink += *(char*)stack.pop();
+            result.ops = count;
+            break;
+
+        case 2: // sawtooth
+            for (int tooth = 0; tooth < 16; tooth++) {
+                fill(stack, element, element_size, count / 8);
+                for (size_t i = 0; i < count / 16; i++) sink += *(char*)stack.pop();
+            }
+            result.ops = 16 * (count / 8 + count / 16);
+            break;
+
+        case 3: { // mixed
+            uint64_t state = 0x9e3779b97f4a7c15ULL;
+            for (size_t i = 0; i < count; i++) {
+                if ((next_random(state) & 1) || stack.is_empty()) stack.push(element, element_size);
+                else sink += *(char*)stack.pop();
+            }
+            result.ops = count;
+            break;
+        }
+    }
+
+    result.seconds = now_seconds() - start;
+    result.cache_misses = counting_misses ? counter.stop() : -1;
+#ifdef __COUNTING_ALLOCATOR__
+    result.malloc_calls = malloc_calls - calls_before;
+#else
+    result.malloc_calls = -1;
+    (void)calls_before;
+#endif
+    read_reload_stats(stack, result.reloads, result.prefetched_reloads);
+
+    drain(stack);
+    free(element);
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    result.peak_rss_kib = usage.ru_maxrss;
+    return result;
+}
+
+static TResult run_in_child(int backend, int workload, size_t element_size, size_t count) {
+    TResult result;
+    memset(&result, 0, sizeof(result));
+
+    int channel[2];
+    if (pipe(channel) != 0) {
+        snprintf(result.error, sizeof(result.error), "pipe failed");
+        return result;
+    }
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(channel[0]);
+        try {
+            switch (backend) {
+                case 0: result = run_workload<TCStackBackend>(workload, element_size, count); break;
+                case 1: result = run_workload<TStack>(workload, element_size, count); break;
+                case 2: result = run_workload<TSpillBackend>(workload, element_size, count); break;
+            }
+        }
+        catch (const char* e) {
+            result.ok = false;
+            snprintf(result.error, sizeof(result.error), "%s", e);
+        }
+        if (write(channel[1], &result, sizeof(result)) != sizeof(result)) _exit(1);
+        _exit(0);
+    }
+
+    close(channel[1]);
+    bool received = read(channel[0], &result, sizeof(result)) == sizeof(result);
+    close(channel[0]);
+
+    int status = 0;
+    if (pid < 0) {
+        memset(&result, 0, sizeof(result));
+        snprintf(result.error, sizeof(result.error), "fork failed");
+    } else if (waitpid(pid, &status, 0) < 0) {
+        result.ok = false;
+        snprintf(result.error, sizeof(result.error), "waitpid failed");
+    } else if (WIFSIGNALED(status)) {
+        result.ok = false;
+        snprintf(result.error, sizeof(result.error), "killed by signal %d (%s)",
+            WTERMSIG(status), strsignal(WTERMSIG(status)));
+    } else if (!received || WEXITSTATUS(status) != 0) {
+        result.ok = false;
+        snprintf(result.error, sizeof(result.error), "exited with status %d", WEXITSTATUS(status));
+    }
+    if (!result.ok && result.error[0] == 0) snprintf(result.error, sizeof(result.error), "no result");
+    return result;
+}
+
+static void print_metric(const char* format, double value, bool json) {
+    if (value < 0) printf(json ? "null" : "%12s", "-");
+    else printf(format, value);
+}
+
+int main(int argc, char** argv) {
+    bool json = false;
+    size_t working_set_mib = 64;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--json")) json = true;
+        else if (!strcmp(argv[i], "--mib") && i + 1 < argc) working_set_mib = strtoul(argv[++i], NULL, 10);
+        else if (!strcmp(argv[i], "--spill-budget") && i + 1 < argc) spill_budget_mib = strtoul(argv[++i], NULL, 10);
+        else {
+            fprintf(stderr, "usage: %s [--json] [--mib N] [--spill-budget N]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (json) {
+        printf("{\n  \"benchmark\": \"q3_stack\",\n  \"timestamp\": %ld,\n", (long)time(NULL));
+        printf("  \"working_set_mib\": %zu,\n  \"spill_budget_mib\": %zu,\n", working_set_mib, spill_budget_mib);
+        printf("  \"results\": [");
+    } else {
+        printf("working set %zu MiB, spill budget %zu MiB\n", working_set_mib, spill_budget_mib);
+        printf("%-12s %-11s %6s %10s %12s %10s %12s %12s %12s %12s\n", "backend", "workload", "size",
+            "ops", "ns/op", "MB/s", "malloc/op", "peak RSS KiB", "cache miss", "prefetched");
+    }
+
+    bool first = true;
+    bool failed = false;
+    for (int backend = 0; backend < 3; backend++) {
+        for (int workload = 0; workload < 4; workload++) {
+            for (size_t element_size : element_sizes) {
+                size_t count = (working_set_mib << 20) / element_size;
+                TResult result = run_in_child(backend, workload, element_size, count);
+                if (result.ok && result.ops == 0) {
+                    result.ok = false;
+                    snprintf(result.error, sizeof(result.error), "no operations");
+                }
+                if (result.ok && workload == 1 && result.prefetched_reloads < result.reloads) {
+                    result.ok = false;
+                    snprintf(result.error, sizeof(result.error), "read-ahead missed %lld of %lld reloads",
+                        result.reloads - result.prefetched_reloads, result.reloads);
+                }
+
+                if (!result.ok) {
+                    failed = true;
+                    if (json) {
+                        printf("%s\n    {\"backend\": \"%s\", \"workload\": \"%s\", \"element_size\": %zu, ",
+                            first ? "" : ",", backends[backend], workloads[workload], element_size);
+                        printf("\"ok\": false, \"error\": \"%s\"}", result.error); // messages hold no quotes.
+                    } else {
+                        printf("%-12s %-11s %6zu FAILED: %s\n", backends[backend], workloads[workload],
+                            element_size, result.error);
+                    }
+                    fflush(stdout);
+                    first = false;
+                    continue;
+                }
+
+                double ns_per_op = result.seconds * 1e9 / result.ops;
+                double ops_per_sec = result.ops / result.seconds;
+                double mb_per_sec = ops_per_sec * element_size / 1e6;
+                double mallocs_per_op = result.malloc_calls < 0 ? -1 : (double)result.malloc_calls / result.ops;
+
+                if (json) {
+                    printf("%s\n    {\"backend\": \"%s\", \"workload\": \"%s\", \"element_size\": %zu, \"ok\": true, \"ops\": %zu, ",
+                        first ? "" : ",", backends[backend], workloads[workload], element_size, result.ops);
+                    printf("\"ns_per_op\": %.3f, \"ops_per_sec\": %.0f, \"mb_per_sec\": %.2f, \"mallocs_per_op\": ",
+                        ns_per_op, ops_per_sec, mb_per_sec);
+                    print_metric("%.4f", mallocs_per_op, true);
+                    printf(", \"peak_rss_kib\": %ld, \"cache_misses\": ", result.peak_rss_kib);
+                    print_metric("%.0f", (double)result.cache_misses, true);
+                    printf(", \"reloads\": ");
+                    print_metric("%.0f", (double)result.reloads, true);
+                    printf(", \"prefetched_reloads\": ");
+                    print_metric("%.0f", (double)result.prefetched_reloads, true);
+                    printf("}");
+                } else {
+                    printf("%-12s %-11s %6zu %10zu %12.2f %10.1f ", backends[backend], workloads[workload],
+                        element_size, result.ops, ns_per_op, mb_per_sec);
+                    print_metric("%12.4f", mallocs_per_op, false);
+                    printf(" %12ld ", result.peak_rss_kib);
+                    print_metric("%12.0f", (double)result.cache_misses, false);
+                    if (result.reloads < 0) printf(" %12s\n", "-");
+                    else printf(" %5lld/%-6lld\n", result.prefetched_reloads, result.reloads);
+                }
+                fflush(stdout);
+                first = false;
+            }
+        }
+    }
+
+    if (json) printf("\n  ]\n}\n");
+    return failed ? 1 : 0;
+}